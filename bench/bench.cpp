@@ -0,0 +1,324 @@
+#include "sue.hpp"
+#include "xboard.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Count every allocation, so we can report them per op. All of the forms are replaced,
+// so that nothing can be allocated by one of ours and freed by the library's, or the other way round
+namespace {
+  std::atomic<size_t> allocations = 0;
+  std::atomic<size_t> frees = 0;
+
+  void* counted_alloc(std::size_t n, std::size_t align = 0) noexcept {
+    ++allocations;
+    if (!n)
+      n = 1;
+    if (!align)
+      return std::malloc(n);
+    // aligned_alloc wants a whole number of alignments
+    return std::aligned_alloc(align, (n + align - 1) / align * align);
+  }
+
+  void counted_free(void* p) noexcept {
+    if (p)
+      ++frees;
+    std::free(p);
+  }
+
+  void* counted_new(std::size_t n, std::size_t align = 0) {
+    if (void* p = counted_alloc(n, align))
+      return p;
+    throw std::bad_alloc{};
+  }
+}
+
+void* operator new(std::size_t n) { return counted_new(n); }
+void* operator new[](std::size_t n) { return counted_new(n); }
+void* operator new(std::size_t n, std::align_val_t align) { return counted_new(n, static_cast<std::size_t>(align)); }
+void* operator new[](std::size_t n, std::align_val_t align) { return counted_new(n, static_cast<std::size_t>(align)); }
+void* operator new(std::size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n); }
+void* operator new[](std::size_t n, const std::nothrow_t&) noexcept { return counted_alloc(n); }
+void* operator new(std::size_t n, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return counted_alloc(n, static_cast<std::size_t>(align));
+}
+void* operator new[](std::size_t n, std::align_val_t align, const std::nothrow_t&) noexcept {
+  return counted_alloc(n, static_cast<std::size_t>(align));
+}
+
+void operator delete(void* p) noexcept { counted_free(p); }
+void operator delete[](void* p) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { counted_free(p); }
+
+namespace aunty_sue {
+  struct sue_bench {
+    using node_t = sue::node_t;
+    using brain_t = sue::brain_t;
+  };
+}
+
+namespace {
+  using namespace aunty_sue;
+  using node_t = sue_bench::node_t;
+  using brain_t = sue_bench::brain_t;
+
+  /// Stops the compiler from throwing away work whose result we never look at
+  template<typename T>
+  inline void keep(T&& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+  }
+
+  struct position_t {
+    const char* name;
+    board_t board;
+    bool white_to_move;
+  };
+
+  board_t empty_board() {
+    board_t ret;
+    for (auto& rank : ret)
+      rank.fill(EmptySquare);
+    return ret;
+  }
+
+  /// Plays the moves blindly, so it's up to the caller to make sure they make sense
+  position_t play(const char* name, std::vector<const char*> moves) {
+    position_t ret{name, default_board, true};
+    for (auto* i : moves) {
+      auto m = str2move(i);
+      auto& from = ret.board[m.first.first][m.first.second];
+      ret.board[m.second.first][m.second.second] = static_cast<piece_t>(from | HAS_MOVED);
+      from = EmptySquare;
+      ret.white_to_move = !ret.white_to_move;
+    }
+    return ret;
+  }
+
+  /// The positions every benchmark runs over. Changing these makes old results incomparable
+  std::vector<position_t> make_positions() {
+    std::vector<position_t> ret;
+
+    ret.push_back(play("opening", {}));
+    ret.push_back(play("forced_capture", {"e2e4", "b7b5"}));
+    ret.push_back(play("open_centre", {"d2d4", "e7e5", "d4e5", "d8h4", "g2g3", "h4g3"}));
+
+    position_t endgame{"rook_endgame", empty_board(), true};
+    endgame.board[0][0] = white(Rook);
+    endgame.board[2][2] = white(King);
+    endgame.board[3][4] = white(Bishop);
+    endgame.board[7][7] = black(Rook);
+    endgame.board[5][5] = black(King);
+    endgame.board[6][1] = black(Bishop);
+    ret.push_back(endgame);
+
+    position_t queens{"queens", empty_board(), true};
+    queens.board[0].fill(white(Queen));
+    queens.board[7].fill(black(Queen));
+    ret.push_back(queens);
+
+    return ret;
+  }
+
+  struct options_t {
+    std::chrono::milliseconds min_time{200};
+    std::string filter;
+  };
+
+  /// Runs op on batches made by setup until we have spent long enough, then prints a line of JSON
+  ///
+  /// Only op is timed and counted: making and destroying the batches are not
+  template<typename Setup, typename Op>
+  void run(const options_t& opts, const char* name, Setup&& setup, Op&& op) {
+    if (!opts.filter.empty() && std::string{name}.find(opts.filter) == std::string::npos)
+      return;
+
+    size_t ops = 0, allocs = 0, freed = 0;
+    std::chrono::nanoseconds elapsed{0};
+
+    while (elapsed < opts.min_time) {
+      auto batch = setup();
+      auto n = batch.size();
+
+      auto allocs_before = allocations.load();
+      auto frees_before = frees.load();
+      auto begin = std::chrono::steady_clock::now();
+
+      for (size_t i = 0; i < n; ++i)
+        op(batch, i);
+
+      elapsed += std::chrono::steady_clock::now() - begin;
+      allocs += allocations.load() - allocs_before;
+      freed += frees.load() - frees_before;
+      ops += n;
+    }
+
+    std::cout << "{\"benchmark\":\"" << name << "\""
+              << ",\"ops\":" << ops
+              << ",\"ns_per_op\":" << static_cast<double>(elapsed.count()) / ops
+              << ",\"allocs_per_op\":" << static_cast<double>(allocs) / ops
+              << ",\"frees_per_op\":" << static_cast<double>(freed) / ops
+              << "}" << std::endl;
+  }
+
+  /// How many ops go in a batch
+  constexpr size_t batch_size = 1024;
+
+  std::vector<std::unique_ptr<node_t>> fresh_nodes(const std::vector<position_t>& positions) {
+    std::vector<std::unique_ptr<node_t>> ret;
+    ret.reserve(batch_size);
+    for (size_t i = 0; i < batch_size; ++i) {
+      auto& pos = positions[i % positions.size()];
+      ret.push_back(std::make_unique<node_t>(pos.board, pos.white_to_move));
+    }
+    return ret;
+  }
+}
+
+int main(int argc, char** argv) {
+  options_t opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--min-time-ms" && i + 1 < argc)
+      opts.min_time = std::chrono::milliseconds{std::stoul(argv[++i])};
+    else if (arg == "--filter" && i + 1 < argc)
+      opts.filter = argv[++i];
+    else {
+      std::cerr << "Usage: " << argv[0] << " [--min-time-ms <ms>] [--filter <substring>]" << std::endl;
+      return 1;
+    }
+  }
+
+  // Results from different kinds of build shouldn't be compared
+  std::cout << "{\"build_type\":\"" << AUNTY_SUE_BUILD_TYPE << "\"}" << std::endl;
+
+  auto positions = make_positions();
+  brain_t brain{std::make_shared<shared_pool_t>(1)};
+
+  run(opts, "update_moves", [&] { return fresh_nodes(positions); },
+      [](auto& batch, size_t i) {
+        batch[i]->update_moves();
+        keep(batch[i]->responses);
+      });
+
+  run(opts, "quick_eval", [&] { return fresh_nodes(positions); },
+      [](auto& batch, size_t i) {
+        batch[i]->quick_eval();
+        keep(batch[i]->weight);
+      });
+
+  run(opts, "get_board_state",
+      [&] {
+        std::vector<board_t> ret;
+        for (size_t i = 0; i < batch_size; ++i)
+          ret.push_back(positions[i % positions.size()].board);
+        return ret;
+      },
+      [](auto& batch, size_t i) {
+        auto state = get_board_state(batch[i]);
+        keep(state);
+      });
+
+  // Every legal move from every position, each added to a fresh node
+  std::vector<std::pair<size_t, move_t>> all_moves;
+  for (size_t i = 0; i < positions.size(); ++i) {
+    node_t n{positions[i].board, positions[i].white_to_move};
+    n.update_moves();
+    for (auto& j : n.responses)
+      all_moves.emplace_back(i, j.first);
+  }
+
+  run(opts, "add_move",
+      [&] {
+        std::vector<std::pair<std::unique_ptr<node_t>, move_t>> ret;
+        for (size_t i = 0; i < batch_size; ++i) {
+          auto& [pos, move] = all_moves[i % all_moves.size()];
+          ret.emplace_back(std::make_unique<node_t>(positions[pos].board, positions[pos].white_to_move), move);
+        }
+        return ret;
+      },
+      [](auto& batch, size_t i) {
+        batch[i].first->add_move(batch[i].second);
+      });
+
+  // Two plies, so there is something to tear down
+  run(opts, "destroy_subtree",
+      [&] {
+        auto ret = fresh_nodes(positions);
+        for (auto& i : ret) {
+          i->expand(brain);
+          for (auto& j : i->responses)
+            j.second->expand(brain);
+        }
+        return ret;
+      },
+      [](auto& batch, size_t i) {
+        batch[i].reset();
+      });
+
+  // The opponent plays their first move, and we pick from fully expanded replies
+  std::vector<std::pair<std::unique_ptr<node_t>, move_t>> thinking;
+  for (auto& pos : positions) {
+    auto root = std::make_unique<node_t>(pos.board, pos.white_to_move);
+    root->expand(brain);
+    if (root->state != game_state::InProgress)
+      continue;
+    auto& [move, child] = *root->responses.begin();
+    child->expand(brain);
+    for (auto& i : child->responses)
+      i.second->expand(brain);
+    root->evaluate(brain);
+    thinking.emplace_back(std::move(root), move);
+  }
+
+  run(opts, "find_best_response",
+      [&] { return std::vector<int>(batch_size); },
+      [&](auto&, size_t i) {
+        auto& [root, move] = thinking[i % thinking.size()];
+        auto res = root->find_best_response(move);
+        keep(res);
+      });
+
+  std::vector<std::string> lines = {
+    "xboard", "protover 2", "new", "variant auntysue", "usermove e2e4", "usermove b8c6", "?", "option Search=MCTS",
+  };
+
+  run(opts, "parse_line", [&] { return std::vector<int>(batch_size); },
+      [&](auto&, size_t i) {
+        auto res = parse_line(lines[i % lines.size()]);
+        keep(res);
+      });
+
+  std::vector<std::string> moves;
+  for (auto& [pos, move] : all_moves) {
+    auto str = move2str(move);
+    moves.emplace_back(str.data(), str.size());
+  }
+
+  run(opts, "str2move", [&] { return std::vector<int>(batch_size); },
+      [&](auto&, size_t i) {
+        auto res = str2move(moves[i % moves.size()]);
+        keep(res);
+      });
+
+  run(opts, "move2str", [&] { return std::vector<int>(batch_size); },
+      [&](auto&, size_t i) {
+        auto res = move2str(all_moves[i % all_moves.size()].second);
+        keep(res);
+      });
+}
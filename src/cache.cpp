@@ -0,0 +1,134 @@
+#include "cache.hpp"
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+namespace aunty_sue {
+  namespace {
+    /// Bump this if the layout ever changes
+    constexpr uint64_t cache_magic = 0x3165757379746e75;
+
+    // A slot is packed as | score (float bits) : 32 | depth + 1 : 16 | unused : 4 | move : 12 |,
+    // so that an empty (zeroed) slot has a depth of 0, and is never valid
+    uint64_t pack(const position_cache_t::entry_t& entry) {
+      uint32_t score_bits;
+      std::memcpy(&score_bits, &entry.score, sizeof(score_bits));
+
+      auto depth = static_cast<uint64_t>(std::clamp(entry.depth, 0, std::numeric_limits<uint16_t>::max() - 1) + 1);
+
+      uint64_t move = (entry.best.first.first << 9) | (entry.best.first.second << 6)
+          | (entry.best.second.first << 3) | entry.best.second.second;
+
+      return (uint64_t{score_bits} << 32) | (depth << 16) | move;
+    }
+
+    std::optional<position_cache_t::entry_t> unpack(uint64_t data) {
+      auto depth = static_cast<int>((data >> 16) & 0xffff);
+      if (depth == 0)
+        return std::nullopt;
+
+      position_cache_t::entry_t ret;
+      auto score_bits = static_cast<uint32_t>(data >> 32);
+      std::memcpy(&ret.score, &score_bits, sizeof(score_bits));
+      ret.depth = depth - 1;
+      ret.best = {
+        {static_cast<int8_t>((data >> 9) & 7), static_cast<int8_t>((data >> 6) & 7)},
+        {static_cast<int8_t>((data >> 3) & 7), static_cast<int8_t>(data & 7)},
+      };
+      return ret;
+    }
+  }
+
+  // Each position may live in one of two slots: the first keeps the deepest result we have seen,
+  // and the second always takes the latest, so that a stale deep result can't lock everyone else out
+  std::optional<position_cache_t::entry_t> position_cache_t::probe(hash_t key) const {
+    auto* bucket = slots + (key % (header->n_slots / 2)) * 2;
+    for (auto* slot = bucket; slot != bucket + 2; ++slot) {
+      auto data = slot->data.load(std::memory_order_relaxed);
+      auto check = slot->check.load(std::memory_order_relaxed);
+      // Either it's someone else's, or someone was halfway through writing it
+      if ((check ^ data) != key)
+        continue;
+      if (auto ret = unpack(data))
+        return ret;
+    }
+    return std::nullopt;
+  }
+
+  void position_cache_t::store(hash_t key, entry_t entry) {
+    if (entry.depth < min_depth)
+      return;
+
+    auto* bucket = slots + (key % (header->n_slots / 2)) * 2;
+
+    auto* slot = bucket + 1;
+    auto old = unpack(bucket->data.load(std::memory_order_relaxed));
+    // Even for the same position, as otherwise one quick search could wipe out a deep one
+    if (!old || old->depth <= entry.depth)
+      slot = bucket;
+
+    auto data = pack(entry);
+    slot->data.store(data, std::memory_order_relaxed);
+    slot->check.store(key ^ data, std::memory_order_relaxed);
+  }
+
+  position_cache_t::position_cache_t(const std::string& path, size_t n_slots) {
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+      throw std::system_error{errno, std::generic_category(), "Could not open the cache at " + path};
+
+    auto fail = [this](auto&& err) {
+      ::close(fd);
+      throw err;
+    };
+
+    // Stop anyone else reading the header while we set it up
+    if (::flock(fd, LOCK_EX) < 0)
+      fail(std::system_error{errno, std::generic_category(), "Could not lock the cache"});
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+      fail(std::system_error{errno, std::generic_category(), "Could not stat the cache"});
+
+    header_t h;
+    if (st.st_size == 0) {
+      h.magic = cache_magic;
+      h.n_slots = std::max<size_t>(n_slots & ~size_t{1}, 2);
+      // A fresh file reads as zeros, which is a table full of empty slots
+      if (::ftruncate(fd, sizeof(header_t) + h.n_slots * sizeof(slot_t)) < 0 ||
+          ::pwrite(fd, &h, sizeof(h), 0) != sizeof(h))
+        fail(std::system_error{errno, std::generic_category(), "Could not create the cache"});
+    }
+    else if (::pread(fd, &h, sizeof(h), 0) != sizeof(h) || h.magic != cache_magic || h.n_slots < 2 || h.n_slots % 2 ||
+             static_cast<size_t>(st.st_size) != sizeof(header_t) + h.n_slots * sizeof(slot_t))
+      fail(std::invalid_argument{path + " is not a compatible cache"});
+
+    ::flock(fd, LOCK_UN);
+
+    mapping_size = sizeof(header_t) + h.n_slots * sizeof(slot_t);
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED)
+      fail(std::system_error{errno, std::generic_category(), "Could not map the cache"});
+
+    // Warm it up now, rather than fault it in a page at a time mid-search
+    ::madvise(mapping, mapping_size, MADV_WILLNEED);
+
+    header = static_cast<header_t*>(mapping);
+    slots = reinterpret_cast<slot_t*>(header + 1);
+  }
+
+  position_cache_t::~position_cache_t() {
+    ::munmap(mapping, mapping_size);
+    ::close(fd);
+  }
+}
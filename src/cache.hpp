@@ -0,0 +1,63 @@
+#pragma once
+
+#include "hash.hpp"
+#include "xboard.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace aunty_sue {
+  /// A table of search results, memory-mapped from a file so that it outlives the engine
+  ///
+  /// Any number of engines and processes may share the same file. Slots are written without locks,
+  /// so two writers can tear a slot, but a torn slot fails its check and just reads as a miss
+  class position_cache_t {
+  public:
+    struct entry_t {
+      /// From the point of view of the side to move
+      float score;
+      /// How many plies were searched below the position
+      int depth;
+      /// The move that got that score, for move ordering and as a fallback answer
+      move_t best;
+    };
+
+    static constexpr size_t default_slots = size_t{1} << 20;
+
+  private:
+    struct slot_t {
+      std::atomic<uint64_t> check;
+      std::atomic<uint64_t> data;
+    };
+    struct header_t {
+      uint64_t magic;
+      uint64_t n_slots;
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "The cache needs to be shared between processes");
+
+    int fd = -1;
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    header_t* header = nullptr;
+    slot_t* slots = nullptr;
+
+  public:
+    /// Results shallower than this aren't worth the space
+    int min_depth = 2;
+
+    std::optional<entry_t> probe(hash_t key) const;
+    void store(hash_t key, entry_t entry);
+
+    inline size_t size() const { return header->n_slots; }
+
+    /// Maps the cache at the given path, creating it with the given size if it doesn't exist yet
+    position_cache_t(const std::string& path, size_t n_slots = default_slots);
+    ~position_cache_t();
+
+    position_cache_t(const position_cache_t&) = delete;
+    position_cache_t& operator=(const position_cache_t&) = delete;
+  };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "xboard.hpp"
+
+#include <array>
+#include <cstdint>
+
+namespace aunty_sue {
+  using hash_t = uint64_t;
+
+  namespace detail {
+    constexpr uint64_t splitmix64(uint64_t& state) {
+      uint64_t z = (state += 0x9e3779b97f4a7c15);
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+      return z ^ (z >> 31);
+    }
+
+    constexpr auto make_zobrist_table() {
+      std::array<std::array<hash_t, 12>, 64> ret{};
+      // Any fixed seed will do, but it must never change, as hashes end up on disk
+      uint64_t state = 0x61756e7479737565;
+      for (auto& square : ret)
+        for (auto& key : square)
+          key = splitmix64(state);
+      return ret;
+    }
+  }
+
+  constexpr auto zobrist_table = detail::make_zobrist_table();
+  constexpr hash_t zobrist_white_to_move = 0x3c6ef372fe94f82a;
+
+  /// Which of the 12 kinds of piece this is, or -1 for an empty square
+  ///
+  /// HAS_MOVED is ignored, as it can only matter for a pawn, and that is already given away by its rank
+  constexpr int zobrist_piece_index(piece_t p) {
+    int side = (p & WHITE_SIDE) ? 0 : 6;
+    switch (p & PIECE_TYPE_MASK) {
+      case Rook: return side + 0;
+      case Knight: return side + 1;
+      case Bishop: return side + 2;
+      case Queen: return side + 3;
+      case King: return side + 4;
+      case Pawn: return side + 5;
+      default: return -1;
+    }
+  }
+
+  constexpr hash_t zobrist_key(coords_t c, piece_t p) {
+    auto index = zobrist_piece_index(p);
+    return index < 0 ? 0 : zobrist_table[c.first * 8 + c.second][index];
+  }
+
+  constexpr hash_t hash_board(const board_t& board, bool white_to_move) {
+    hash_t ret = white_to_move ? zobrist_white_to_move : 0;
+    for (int8_t rank = 0; rank < 8; ++rank)
+      for (int8_t file = 0; file < 8; ++file)
+        ret ^= zobrist_key({rank, file}, board[rank][file]);
+    return ret;
+  }
+
+  /// The hash of the position after playing the move, given the hash of the position before
+  constexpr hash_t hash_move(hash_t hash, const board_t& board, move_t m) {
+    auto piece = board[m.first.first][m.first.second];
+    return hash
+        ^ zobrist_white_to_move
+        ^ zobrist_key(m.first, piece)
+        ^ zobrist_key(m.second, board[m.second.first][m.second.second])
+        ^ zobrist_key(m.second, piece);
+  }
+}
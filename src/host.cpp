@@ -0,0 +1,81 @@
+#include "host.hpp"
+
+#include "sue.hpp"
+#include "xboard.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+namespace aunty_sue {
+  void run_host(uint16_t port, size_t threads, std::shared_ptr<position_cache_t> cache, sue::search_mode mode) {
+    using boost::asio::ip::tcp;
+
+    auto pool = std::make_shared<shared_pool_t>(threads);
+
+    boost::asio::io_context ctx;
+    tcp::acceptor acceptor{ctx, tcp::endpoint{tcp::v4(), port}};
+
+    std::clog << "Hosting on port " << port << " with " << pool->size() << " search threads" << std::endl;
+
+    while (true) {
+      auto out = std::make_unique<tcp::iostream>();
+      boost::system::error_code err;
+      // Running out of file descriptors or a client hanging up early shouldn't take every other game down with it
+      if (acceptor.accept(out->socket(), err)) {
+        std::clog << "Could not accept a connection: " << err.message() << std::endl;
+        // Give whatever ran out a chance to come back, rather than spinning
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        continue;
+      }
+
+      // The reader thread gets its own stream over a copy of the socket, so that it shares no buffers with the writer
+      auto in = std::make_unique<tcp::iostream>();
+      int read_fd = ::dup(out->socket().native_handle());
+      if (read_fd < 0) {
+        std::clog << "Dropped a connection: " << std::strerror(errno) << std::endl;
+        continue;
+      }
+      if (in->socket().assign(tcp::v4(), read_fd, err)) {
+        ::close(read_fd);
+        std::clog << "Dropped a connection: " << err.message() << std::endl;
+        continue;
+      }
+
+      // The session thread spends nearly all of its time blocked on the socket,
+      // so the real work is all bounded by the pool
+      try {
+        std::thread{[pool, cache, mode, in = std::move(in), out = std::move(out)] {
+          try {
+            sue eng{pool};
+            eng.mode = mode;
+            if (cache)
+              eng.use_cache(cache);
+            eng.thinking_out = out.get();
+            run_engine(eng, *in, *out, [fd = in->socket().native_handle()] {
+              // Wakes the reader up with an end of file
+              ::shutdown(fd, SHUT_RD);
+            });
+          }
+          catch (std::exception& e) {
+            std::clog << "Session ended: " << e.what() << std::endl;
+          }
+        }}.detach();
+      }
+      // Out of threads, which is no reason to stop serving the games we already have
+      catch (std::system_error& e) {
+        std::clog << "Dropped a connection: " << e.what() << std::endl;
+      }
+    }
+  }
+}
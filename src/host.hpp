@@ -0,0 +1,16 @@
+#pragma once
+
+#include "cache.hpp"
+#include "sue.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace aunty_sue {
+  /// Accepts xboard sessions over TCP, and plays all of them in this process
+  ///
+  /// Every game gets its own engine, but they all search on one shared pool, and share the cache if given one
+  [[noreturn]] void run_host(uint16_t port, size_t threads, std::shared_ptr<position_cache_t> cache = nullptr,
+                             sue::search_mode mode = sue::search_mode::Minimax);
+}
@@ -1,13 +1,49 @@
+#include "cache.hpp"
+#include "host.hpp"
 #include "sue.hpp"
 #include "xboard.hpp"
 
 #include <fstream>
 
 #include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
 #include <thread>
 
-int main() {
+int main(int argc, char** argv) {
 //  std::this_thread::sleep_for(std::chrono::seconds{10});
+
+  // aunty_sue [--mcts] [--cache <path>] [--host <port> [threads]]
+  std::shared_ptr<aunty_sue::position_cache_t> cache;
+  std::optional<uint16_t> host_port;
+  size_t threads = std::thread::hardware_concurrency();
+  auto mode = aunty_sue::sue::search_mode::Minimax;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--mcts")
+      mode = aunty_sue::sue::search_mode::MonteCarlo;
+    else if (arg == "--cache" && i + 1 < argc)
+      cache = std::make_shared<aunty_sue::position_cache_t>(argv[++i]);
+    else if (arg == "--host" && i + 1 < argc) {
+      host_port = static_cast<uint16_t>(std::stoul(argv[++i]));
+      if (i + 1 < argc && argv[i + 1][0] != '-')
+        threads = std::stoul(argv[++i]);
+    }
+    else {
+      std::cerr << "Usage: " << argv[0] << " [--mcts] [--cache <path>] [--host <port> [threads]]" << std::endl;
+      return 1;
+    }
+  }
+
+  if (host_port)
+    aunty_sue::run_host(*host_port, threads, cache, mode);
+
   aunty_sue::sue eng;
+  eng.mode = mode;
+  if (cache)
+    eng.use_cache(cache);
+  eng.thinking_out = &std::cout;
   aunty_sue::run_engine(eng);
 }
@@ -0,0 +1,91 @@
+#include "pool.hpp"
+
+#include <algorithm>
+
+#include <boost/asio/post.hpp>
+
+namespace aunty_sue {
+  void shared_pool_t::lane_t::post(task_t task) {
+    {
+      std::lock_guard lock{owner.mutex};
+      queue.push_back(std::move(task));
+      if (!scheduled) {
+        owner.ready_for(*this).push_back(this);
+        scheduled = true;
+      }
+    }
+
+    // Every task gets a token, but the token runs whatever lane is next in line
+    boost::asio::post(owner.workers, [pool = &owner] { pool->run_one(); });
+  }
+
+  void shared_pool_t::lane_t::cancel() {
+    std::unique_lock lock{owner.mutex};
+    // Anything still running may post more work, so only clear up once it's all done
+    idle.wait(lock, [this] { return running == 0; });
+    queue.clear();
+    if (scheduled) {
+      auto& ready = owner.ready_for(*this);
+      ready.erase(std::find(ready.begin(), ready.end(), this));
+      scheduled = false;
+    }
+    // The tokens for what we just threw away will find nothing to do, which is fine
+  }
+
+  void shared_pool_t::lane_t::set_urgent(bool value) {
+    std::lock_guard lock{owner.mutex};
+    if (urgent == value)
+      return;
+
+    if (scheduled) {
+      auto& from = owner.ready_for(*this);
+      from.erase(std::find(from.begin(), from.end(), this));
+    }
+    urgent = value;
+    // Every queued task still has its token, so moving the lane is all it takes
+    if (scheduled)
+      owner.ready_for(*this).push_back(this);
+  }
+
+  bool shared_pool_t::lane_t::busy() {
+    std::lock_guard lock{owner.mutex};
+    return running || !queue.empty();
+  }
+
+  void shared_pool_t::run_one() {
+    std::unique_lock lock{mutex};
+    // Tokens aren't tied to a lane, so whoever is in a hurry gets the next one
+    auto& from = urgent_ready.empty() ? ready : urgent_ready;
+    // Someone cancelled the task this token was posted for
+    if (from.empty())
+      return;
+
+    auto* lane = from.front();
+    from.pop_front();
+
+    auto task = std::move(lane->queue.front());
+    lane->queue.pop_front();
+    // Go to the back of the line, so that everyone else gets a turn first
+    if (lane->queue.empty())
+      lane->scheduled = false;
+    else
+      from.push_back(lane);
+
+    ++lane->running;
+    lock.unlock();
+
+    task();
+
+    lock.lock();
+    // The lane cannot be destroyed until running hits 0, so this is safe
+    if (--lane->running == 0)
+      lane->idle.notify_all();
+  }
+
+  shared_pool_t::shared_pool_t(size_t threads) :
+    n_threads{std::max<size_t>(threads, 1)}, workers{n_threads} {}
+
+  shared_pool_t::~shared_pool_t() {
+    workers.join();
+  }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/asio/thread_pool.hpp>
+
+namespace aunty_sue {
+  /// A set of worker threads that any number of engines can share
+  ///
+  /// Every engine gets its own lane, and the workers take tasks from the lanes in turn,
+  /// so one engine with an enormous backlog cannot starve everyone else.
+  /// Urgent lanes (engines on the clock) are all served before any of the others (engines pondering)
+  class shared_pool_t {
+  public:
+    using task_t = std::function<void()>;
+
+    class lane_t {
+      friend shared_pool_t;
+
+    private:
+      shared_pool_t& owner;
+      std::deque<task_t> queue;
+      std::condition_variable idle;
+      size_t running = 0;
+      bool scheduled = false;
+      bool urgent = false;
+
+    public:
+      void post(task_t task);
+      /// Throws away everything queued, and waits for anything still running to finish
+      void cancel();
+      /// Whether anything is queued or running
+      bool busy();
+      /// Puts this lane ahead of every lane that isn't urgent, or back in with them
+      void set_urgent(bool value);
+
+      inline lane_t(shared_pool_t& owner_) : owner{owner_} {}
+      inline ~lane_t() { cancel(); }
+    };
+
+  private:
+    std::mutex mutex;
+    /// Lanes with queued work, in the order they will be served
+    std::deque<lane_t*> ready;
+    /// The same, for urgent lanes, which go first
+    std::deque<lane_t*> urgent_ready;
+    size_t n_threads;
+    boost::asio::thread_pool workers;
+
+    void run_one();
+    inline std::deque<lane_t*>& ready_for(const lane_t& lane) { return lane.urgent ? urgent_ready : ready; }
+
+  public:
+    /// The lane must be destroyed before the pool
+    inline std::unique_ptr<lane_t> make_lane() { return std::make_unique<lane_t>(*this); }
+    inline size_t size() const { return n_threads; }
+
+    shared_pool_t(size_t threads = std::thread::hardware_concurrency());
+    ~shared_pool_t();
+  };
+}
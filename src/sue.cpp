@@ -1,23 +1,29 @@
 #include "sue.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <random>
 #include <thread>
 #include <chrono>
 
 #include <fstream>
 
-#include <boost/asio/post.hpp>
-
 using namespace std::chrono_literals;
 
 namespace aunty_sue {
   void sue::brain_t::stop() {
-    if (thinking.exchange(false)) {
-      pool->stop();
-      pool->join();
-    }
+    if (thinking.exchange(false))
+      lane->cancel();
   }
 
-  void sue::node_t::quick_eval() {
+  bool sue::brain_t::may_expand(int half_moves_made) {
+    if (expand_before && half_moves_made >= expand_before)
+      return false;
+    // Take it out of the budget first, so that the workers can't overshoot it between them
+    return !node_limited || node_budget.fetch_sub(1) > 0;
+  }
+
+  sue::leaf_t sue::node_t::material(const board_t& board, bool is_white) {
     // TODO: actual piecewise calc
     int sum = 0;
     for (auto& rank : board) {
@@ -29,58 +35,201 @@ namespace aunty_sue {
       }
     }
 
-    weight = is_white ? -sum : sum;
+    return is_white ? -sum : sum;
   }
 
-  void sue::node_t::evaluate(brain_t& brain, bool top) {
+  void sue::node_t::quick_eval() {
+    weight = material(board, is_white);
+  }
+
+  void sue::node_t::evaluate(brain_t& brain) {
     switch (state) {
       case game_state::Draw: {
         weight = 0;
+        history_dependent = drawn_by_rule;
+        // A draw by rule only stopped us looking, but one on the board is final
+        depth = drawn_by_rule ? 0 : exact_depth;
       } break;
       case game_state::WhiteWins: {
         weight = is_white ?
               std::numeric_limits<leaf_t>::infinity() :
               -std::numeric_limits<leaf_t>::infinity();
+        depth = exact_depth;
       } break;
       case game_state::BlackWins: {
         weight = is_white ?
               -std::numeric_limits<leaf_t>::infinity() :
               std::numeric_limits<leaf_t>::infinity();
+        depth = exact_depth;
       } break;
       case game_state::InProgress: {
-        weight = -std::numeric_limits<leaf_t>::infinity();
+        weight = std::numeric_limits<leaf_t>::infinity();
+        depth = exact_depth;
+        history_dependent = false;
+        auto best = responses.begin();
 
-        for (auto& i : responses) {
+        for (auto iter = responses.begin(); iter != responses.end(); ++iter) {
+          auto& i = *iter;
           i.second->evaluate(brain);
           // Subtract, as we don't want them to win!
           //
-          // I have messed this up before, to hilarious effect
-          if (i.second->weight > weight)
+          // I have messed this up before, to hilarious effect: we want the reply that leaves them worst off
+          if (i.second->weight < weight) {
             weight = i.second->weight;
+            best = iter;
+          }
+          // Exact results stay exact however far up they go
+          depth = std::min(depth, i.second->depth == exact_depth ? exact_depth : i.second->depth + 1);
+          history_dependent |= i.second->history_dependent;
         }
         weight = -weight;
+
+        // Someone may have looked deeper than we have, in which case we believe them
+        if (brain.cache) {
+          if (auto hit = brain.cache->probe(hash); hit && hit->depth > depth) {
+            weight = hit->score;
+            depth = hit->depth;
+            history_dependent = false;
+          }
+          // Another game reaching this position by a different route may not be able to repeat anything
+          else if (!history_dependent)
+            brain.cache->store(hash, {static_cast<float>(weight), depth, best->first});
+        }
       } break;
-      // If we have no idea what is going on, perform a quick eval, and return
+      // If we haven't looked any deeper, go with the preliminary analysis
       default: {
-        quick_eval();
+        if (weight != weight)
+          quick_eval();
       } break;
     }
 
-
     if (brain.max_move_seen < half_moves_made)
       brain.max_move_seen.exchange(half_moves_made);
-    if (top)
-      std::cout << ' ' << brain.max_move_seen << ' ' << weight * 100 << " 0 0 help me" << std::endl;
+  }
+
+  sue::leaf_t sue::node_t::quiesce(const brain_t& brain, const board_t& board, bool is_white, leaf_t alpha, leaf_t beta,
+                                   int plies_left) {
+    switch (get_board_state(board)) {
+      case game_state::WhiteWins: {
+        return is_white ?
+              std::numeric_limits<leaf_t>::infinity() :
+              -std::numeric_limits<leaf_t>::infinity();
+      }
+      case game_state::BlackWins: {
+        return is_white ?
+              -std::numeric_limits<leaf_t>::infinity() :
+              std::numeric_limits<leaf_t>::infinity();
+      }
+      default: break;
+    }
+
+    auto weight = material(board, is_white);
+    // A capture chain can run long, and we may have been told to answer now
+    if (plies_left == 0 || !brain.thinking)
+      return weight;
 
-//
+    // On the stack, as nearly all of these are thrown away straight after
+    move_list_t moves;
+    bool must_take = legal_moves(board, is_white, moves);
+
+    if (moves.empty())
+      return 0;
+    // In a quiet position, the material count actually means something, so we stand pat.
+    //
+    // Unlike in normal chess, this is the only place we may: if there is a capture, we have to take it
+    if (!must_take)
+      return weight;
+
+    // Delta pruning, bent to fit forced captures. We take one of theirs now, and they can take at most one of ours
+    // each turn they get, so the material can only swing so far before we run out of plies. That doesn't hold if
+    // they could take everything we have (which wins it for us), and a line with no moves left scores 0
+    int their_turns = plies_left / 2;
+    int ours = 0;
+    for (auto& rank : board)
+      for (auto& square : rank)
+        ours += (square & (is_white ? WHITE_SIDE : BLACK_SIDE)) != 0;
+    if (ours > their_turns) {
+      auto ceiling = std::max<leaf_t>(weight - 1 + their_turns, 0);
+      if (ceiling <= alpha)
+        return ceiling;
+    }
+
+    leaf_t best = -std::numeric_limits<leaf_t>::infinity();
+    for (auto m : moves) {
+      auto next = board;
+      make_move(next, m);
+      auto score = -quiesce(brain, next, !is_white, -beta, -alpha, plies_left - 1);
+      if (score > best)
+        best = score;
+      if (best > alpha)
+        alpha = best;
+      // They will never let the game get here
+      if (alpha >= beta)
+        break;
+    }
+    return best;
   }
 
-  void sue::node_t::process(brain_t& brain) {
+  bool sue::node_t::is_repetition(const brain_t& brain) const {
+    // Nothing from before a capture or a pawn move can come back, so we only need to look that far
+    int plies_left = quiet_moves;
+
+    const node_t* ancestor = parent;
+    for (; ancestor && plies_left > 0; ancestor = ancestor->parent, --plies_left) {
+      if (ancestor->hash == hash)
+        return true;
+    }
+    if (ancestor)
+      return false;
+
+    // Then carry on back through the game
+    for (auto iter = brain.history.rbegin(); iter != brain.history.rend() && plies_left > 0; ++iter, --plies_left) {
+      if (*iter == hash)
+        return true;
+    }
+    return false;
+  }
+
+  bool sue::node_t::check_draw(const brain_t& brain) {
+    if (state != game_state::NotAWin)
+      return state == game_state::Draw;
+
+    // The first repetition is enough: if going round in circles was any good, it will still be good after the third time
+    if (quiet_moves >= fifty_move_plies || is_repetition(brain)) {
+      state = game_state::Draw;
+      drawn_by_rule = true;
+      return true;
+    }
+    return false;
+  }
+
+  void sue::node_t::expand(const brain_t& brain) {
+    // The root's own draws are for result to sort out, as the game may not end there
+    if (parent && check_draw(brain))
+      return;
+
     // Check if we understand what this state is
     if (state == game_state::NotAWin) {
       update_moves();
       state = (responses.size() == 0) ? game_state::Draw : game_state::InProgress;
     }
+  }
+
+  void sue::node_t::process(brain_t& brain) {
+    // If we need to stop, quickly terminate
+    if (!brain.thinking) // The best line of code I have ever written
+      return;
+
+    if (state == game_state::NotAWin) {
+      // The preliminary analysis will have to do
+      if (!brain.may_expand(half_moves_made))
+        return;
+      expand(brain);
+      ++brain.nodes;
+      // Our responses are the deepest thing we have seen
+      if (brain.max_move_seen < half_moves_made + 1)
+        brain.max_move_seen.exchange(half_moves_made + 1);
+    }
 
     // We don't need to think about a finished game
     if (state != game_state::InProgress)
@@ -92,27 +241,210 @@ namespace aunty_sue {
 
     // If we get here, there we are in an in-progress gam
 
-    // If we need to stop, quickly terminate
-    if (!brain.thinking) // The best line of code I have ever written
-      return;
-
-    // Perform a preliminary analysis, so we can optimise with a
+    // Perform a preliminary analysis, playing out any captures, so we can optimise with a
     for (auto& i : responses) {
-      if (i.second->weight != i.second->weight)
-        i.second->quick_eval();
+      auto& possibility = *i.second;
+      if (possibility.weight != possibility.weight) {
+        std::optional<position_cache_t::entry_t> hit;
+        // No point looking any further down a line that goes round in circles
+        if (possibility.check_draw(brain))
+          possibility.weight = 0;
+        // If we need to stop, a rough idea will have to do
+        else if (!brain.thinking)
+          possibility.quick_eval();
+        // Nothing we could work out here would beat something we already worked out properly
+        else if (brain.cache && (hit = brain.cache->probe(possibility.hash))) {
+          possibility.weight = hit->score;
+          possibility.depth = hit->depth;
+        }
+        // Monte Carlo may have grown a subtree here already, which knows more than quiesce would
+        else if (possibility.state != game_state::NotAWin || !possibility.responses.empty())
+          possibility.evaluate(brain);
+        else
+          possibility.weight = quiesce(brain, possibility.board, possibility.is_white,
+                                       -std::numeric_limits<leaf_t>::infinity(), std::numeric_limits<leaf_t>::infinity(),
+                                       max_quiescence_plies);
+      }
     }
 
-    // TODO: proper breadth-first seach, prioritising good moves, with a curve on depth spent
-    for (auto& i : responses) {
-      auto* possibility = i.second.get();
-      boost::asio::post(*brain.pool, [possibility, &brain] {
+    auto post = [&brain](node_t* possibility) {
+      brain.post([possibility, &brain] {
         possibility->process(brain);
       });
+    };
+
+    // Whatever did best last time gets looked at first
+    auto hinted = responses.end();
+    if (brain.cache) {
+      if (auto hit = brain.cache->probe(hash))
+        hinted = responses.find(hit->best);
     }
+    if (hinted != responses.end())
+      post(hinted->second.get());
+
+    // TODO: proper breadth-first seach, prioritising good moves, with a curve on depth spent
+    for (auto iter = responses.begin(); iter != responses.end(); ++iter) {
+      if (iter != hinted)
+        post(iter->second.get());
+    }
+  }
+
+  void sue::node_t::run_playouts(brain_t& brain) {
+    if (!brain.thinking)
+      return;
+
+    simulate(brain);
+
+    // Go to the back of the queue, so that other games get a look in
+    brain.post([this, &brain] {
+      run_playouts(brain);
+    });
+  }
+
+  void sue::node_t::simulate(brain_t& brain) {
+    std::vector<node_t*> path{this};
+    ++visits;
+
+    node_t* current = this;
+    // Whether we can trust current->state
+    bool settled = true;
+
+    while (true) {
+      int expected = 0;
+      if (current->mcts_expansion.compare_exchange_strong(expected, 1)) {
+        // Over the limits, so leave it for the playout
+        if (!brain.may_expand(current->half_moves_made)) {
+          current->mcts_expansion = 0;
+          break;
+        }
+        current->expand(brain);
+        ++brain.nodes;
+        if (brain.max_move_seen < current->half_moves_made + 1)
+          brain.max_move_seen.exchange(current->half_moves_made + 1);
+        current->mcts_expansion = 2;
+        break;
+      }
+      // Someone else is halfway through expanding it, so just play out from here
+      if (expected == 1) {
+        settled = false;
+        break;
+      }
+      if (current->state != game_state::InProgress)
+        break;
+
+      current = current->select();
+      ++current->visits;
+      path.push_back(current);
+    }
+
+    game_state result = game_state::NotAWin;
+    if (settled) {
+      switch (current->state) {
+        case game_state::WhiteWins:
+        case game_state::BlackWins:
+        case game_state::Draw:
+          result = current->state;
+          break;
+        default: break;
+      }
+    }
+    if (result == game_state::NotAWin)
+      result = current->playout();
+
+    for (auto* i : path) {
+      switch (result) {
+        // The mover is whoever isn't to move now
+        case game_state::WhiteWins: i->value += i->is_white ? 0 : 2; break;
+        case game_state::BlackWins: i->value += i->is_white ? 2 : 0; break;
+        default: i->value += 1; break;
+      }
+    }
+  }
+
+  sue::node_t* sue::node_t::select() {
+    auto log_visits = std::log(static_cast<leaf_t>(std::max(visits.load(), 1)));
+
+    node_t* best = nullptr;
+    leaf_t best_score = -std::numeric_limits<leaf_t>::infinity();
+    for (auto& i : responses) {
+      auto& child = *i.second;
+      int n = child.visits;
+      // Everything gets a look before anything gets a second one
+      if (n == 0)
+        return &child;
+
+      auto score = child.value / (2.0 * n) + exploration * std::sqrt(log_visits / n);
+      if (score > best_score) {
+        best_score = score;
+        best = &child;
+      }
+    }
+    return best;
+  }
+
+  game_state sue::node_t::playout() const {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+
+    // One board, played on in place, as we only ever keep one of the moves
+    auto current = board;
+    bool white = is_white;
+    int quiet = quiet_moves;
+    move_list_t moves;
+
+    for (int ply = 0; ply < max_playout_plies; ++ply) {
+      if (auto state = get_board_state(current); state != game_state::NotAWin)
+        return state;
+      if (quiet >= fifty_move_plies)
+        return game_state::Draw;
+
+      // Captures are compulsory, so there is usually not much to choose from anyway
+      moves.clear();
+      legal_moves(current, white, moves);
+      if (moves.empty())
+        return game_state::Draw;
+
+      std::uniform_int_distribution<size_t> dist{0, moves.size - 1};
+      auto m = *std::next(moves.begin(), dist(rng));
+      quiet = is_irreversible(current, m) ? 0 : quiet + 1;
+      make_move(current, m);
+      white = !white;
+    }
+
+    // It's gone on too long, so whoever has fewer pieces left is probably winning
+    if (auto state = get_board_state(current); state != game_state::NotAWin)
+      return state;
+    auto weight = material(current, white);
+    if (weight == 0)
+      return game_state::Draw;
+    return ((weight > 0) == white) ? game_state::WhiteWins : game_state::BlackWins;
+  }
+
+  std::optional<sue::node_t::choice_t> sue::node_t::most_visited() {
+    if (state != game_state::InProgress)
+      return std::nullopt;
+
+    auto best = responses.end();
+    int best_visits = 0;
+    for (auto iter = responses.begin(); iter != responses.end(); ++iter) {
+      if (iter->second->visits > best_visits) {
+        best_visits = iter->second->visits;
+        best = iter;
+      }
+    }
+
+    if (best == responses.end())
+      return std::nullopt;
+    return best;
   }
 
   void sue::node_t::update_moves() {
-    piece_t side_mask = is_white ? WHITE_SIDE : BLACK_SIDE;
+    move_list_t moves;
+    must_take = legal_moves(board, is_white, moves);
+    for (auto m : moves)
+      add_move(m);
+  }
+
+  bool sue::node_t::legal_moves(const board_t& board, bool is_white, move_list_t& moves) {
     piece_t enemy_mask = is_white ? BLACK_SIDE : WHITE_SIDE;
 
     int8_t pawn_promote_rank = is_white ? (8 - 1) : (1 - 1);
@@ -120,296 +452,358 @@ namespace aunty_sue {
 
     bool can_take = false;
 
+    // Once we find a capture, everything we found before it is off the table
+    auto take = [&](move_t m) {
+      if (!can_take) {
+        moves.clear();
+        can_take = true;
+      }
+      moves.push_back(m);
+    };
+    auto step = [&](move_t m) {
+      if (!can_take)
+        moves.push_back(m);
+    };
+    // Slides until it hits something, which it takes if it can
+    auto slide = [&](coords_t from, int8_t d_rank, int8_t d_file) {
+      for (coords_t pos{from.first + d_rank, from.second + d_file}; validate_coords(pos); pos.first += d_rank, pos.second += d_file) {
+        auto occupant = board[pos.first][pos.second];
+        if (occupant & enemy_mask) {
+          take({from, pos});
+          break;
+        }
+        else if (occupant == EmptySquare)
+          step({from, pos});
+        else
+          break;
+      }
+    };
+
     for (int8_t rank = 0; rank < 8; ++rank) {
       for (int8_t file = 0; file < 8; ++file) {
-        auto& square = board[rank][file];
+        auto square = board[rank][file];
         if (square & enemy_mask)
           continue;
 
         coords_t from = {rank, file};
-        auto p = static_cast<piece_t>(square & PIECE_TYPE_MASK);
 
         if (square & PIECE_TYPE_MASK & Pawn) {
           if (rank == pawn_promote_rank)
             continue; //TODO
-//              abort(); // TODO
 
           int8_t forward_rank = is_white ? (rank + 1) : (rank - 1);
 
           coords_t one_target = {forward_rank, file};
           // If we can't move one, we can't move two
           if (!can_take && board[one_target.first][one_target.second] == EmptySquare) {
-            add_move({from, one_target});
+            step({from, one_target});
 
             coords_t two_target = {pawn_precomp_two_rank, file};
             if (!(square & HAS_MOVED) && board[two_target.first][two_target.second] == EmptySquare)
-              add_move(move_t{from, two_target});
+              step({from, two_target});
           }
 
-          {
-            coords_t left_target = {forward_rank, file - 1};
-            if (file != 0 && (board[left_target.first][left_target.second] & enemy_mask)) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, left_target});
-            }
-          }
-
-          {
-            coords_t right_target = {forward_rank, file + 1};
-            if (file != 7 && (board[right_target.first][right_target.second] & enemy_mask)) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, right_target});
-            }
-          }
+          if (file != 0 && (board[forward_rank][file - 1] & enemy_mask))
+            take({from, {forward_rank, file - 1}});
+          if (file != 7 && (board[forward_rank][file + 1] & enemy_mask))
+            take({from, {forward_rank, file + 1}});
 
           continue;
         }
 
         if (square & PIECE_TYPE_MASK & Rook) {
-          for (int8_t target_rank = rank - 1; target_rank >= 0; --target_rank) {
-            auto& occupant = board[target_rank][file];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, {target_rank, file}});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, {target_rank, file}});
-            }
-            else
-              break;
-          }
-          for (int8_t target_rank = rank + 1; target_rank <= 7; ++target_rank) {
-            auto& occupant = board[target_rank][file];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, {target_rank, file}});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, {target_rank, file}});
-            }
-            else
-              break;
-          }
-          for (int8_t target_file = file - 1; target_file >= 0; --target_file) {
-            auto& occupant = board[rank][target_file];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, {rank, target_file}});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                 add_move(move_t{from, {rank, target_file}});
-            }
-            else
-              break;
-          }
-          for (int8_t target_file = file + 1; target_file <= 7; ++target_file) {
-            auto& occupant = board[rank][target_file];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, {rank, target_file}});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, {rank, target_file}});
-            }
-            else
-              break;
-          }
+          slide(from, -1, 0);
+          slide(from, 1, 0);
+          slide(from, 0, -1);
+          slide(from, 0, 1);
         }
 
         if (square & PIECE_TYPE_MASK & Bishop) {
-          for (coords_t pos{from.first + 1, from.second + 1}; validate_coords(pos); ++pos.first,++pos.second) {
-            auto& occupant = board[pos.first][pos.second];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, pos});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, pos});
-            }
-            else
-              break;
-          }
-          for (coords_t pos{from.first + 1, from.second - 1}; validate_coords(pos); ++pos.first,--pos.second) {
-            auto& occupant = board[pos.first][pos.second];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, pos});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, pos});
-            }
-            else
-              break;
-          }
-          for (coords_t pos{from.first - 1, from.second + 1}; validate_coords(pos); --pos.first,++pos.second) {
-            auto& occupant = board[pos.first][pos.second];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, pos});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, pos});
-            }
-            else
-              break;
-          }
-          for (coords_t pos{from.first - 1, from.second - 1}; validate_coords(pos); --pos.first,--pos.second) {
-            auto& occupant = board[pos.first][pos.second];
-            if (occupant & enemy_mask) {
-              if (!can_take) {
-                responses.clear();
-                can_take = true;
-              }
-              add_move(move_t{from, pos});
-              break;
-            }
-            else if (occupant == EmptySquare && !can_take) {
-              if (!can_take)
-                add_move(move_t{from, pos});
-            }
-            else
-              break;
-          }
+          slide(from, 1, 1);
+          slide(from, 1, -1);
+          slide(from, -1, 1);
+          slide(from, -1, -1);
         }
       }
     }
+
+    return can_take;
   }
 
-  std::optional<sue::node_t::thought_t> sue::node_t::find_best_response(move_t move) {
+  std::optional<sue::node_t::choice_t> sue::node_t::find_best(bool hurry) {
     switch(state) {
       // Check if the game is over
       case game_state::InProgress: break;
-      //If we haven't looked into this move, we cannot find a valid, let alone good, response move
+      // If we haven't looked into this position, we cannot find a valid, let alone good, move
       //
       // Ask for more time
-      case game_state::Unknown: return std::nullopt;
+      case game_state::Unknown:
+      case game_state::NotAWin: return std::nullopt;
       default: throw game_over{state};
     }
 
-    // Look for our move in the table
-    auto iter = responses.find(move);
-
-    // If we haven't seen this move, then we are even more boned.
-    //
-    // Since we are of course infallable, this must be an illegal move.
-    if (iter == responses.end())
-      throw illegal_move{};
-    auto& choices = iter->second->responses;
-
     // The game state check proves that we have at least one candidate choice
-    auto current_best = choices.begin();
-
-    auto choice_iter = current_best;
-    ++choice_iter;
-
-    for (; choice_iter != choices.end(); ++choice_iter) {
-      switch (choice_iter->second->state) {
-        case game_state::WhiteWins: {
-          // If this move loses us the game, then the current best cannot be any worse
-          if (!is_white)
-            continue;
-          // Alternatively, if this wins us the game, then the current best cannot be any better
-          else
-            current_best = iter;
-        } break;
+    auto current_best = responses.end();
+
+    for (auto choice_iter = responses.begin(); choice_iter != responses.end(); ++choice_iter) {
+      auto& choice = *choice_iter->second;
+      switch (choice.state) {
+        case game_state::WhiteWins:
         case game_state::BlackWins: {
-          // If this move loses us the game, then the current best cannot be any worse
-          if (is_white)
-            continue;
-          // Alternatively, if this wins us the game, then the current best cannot be any better
-          else
-            current_best = iter;
-        } break;
-        case game_state::Draw: {
-          // A draw is worth going for if we are losing,
-          // or we do not know what the current best choice entails (NaN returns false)
-          if (current_best->second->weight < 0)
+          // If this wins us the game, then nothing can be any better
+          if ((choice.state == game_state::WhiteWins) == is_white)
+            return choice_iter;
+          // Alternatively, if this loses us the game, then anything else cannot be any worse
+          if (current_best == responses.end())
             current_best = choice_iter;
         } break;
+        case game_state::NotAWin: {
+          if (!hurry)
+            return std::nullopt;
+        } [[fallthrough]];
+        case game_state::Draw:
         case game_state::InProgress: {
-          // We go for a "devil you know" strategy.
+          // Weights are from the opponent's point of view, so we want the lowest.
           //
-          // As such, this comparison will return false for a NaN,
+          // We go for a "devil you know" strategy: this comparison will return false for a NaN,
           // meaning that we skip any uncomputed state
-          if (current_best->second->weight > choice_iter->second->weight)
+          if (current_best == responses.end() || !(current_best->second->weight <= choice.weight))
             current_best = choice_iter;
         } break;
 
-        case game_state::NotAWin: {
-          return std::nullopt;
-        } break;
-
         default: throw std::logic_error{"Something terrible happened with game_state..."};
       }
     }
 
-    return sue::node_t::thought_t{iter->second.get(), current_best};
+    return current_best;
+  }
+
+  std::optional<sue::node_t::thought_t> sue::node_t::find_best_response(move_t move) {
+    switch(state) {
+      // Check if the game is over
+      case game_state::InProgress: break;
+      //If we haven't looked into this move, we cannot find a valid, let alone good, response move
+      //
+      // Ask for more time
+      case game_state::Unknown: return std::nullopt;
+      default: throw game_over{state};
+    }
+
+    // Look for our move in the table
+    auto iter = responses.find(move);
+
+    // If we haven't seen this move, then we are even more boned.
+    //
+    // Since we are of course infallable, this must be an illegal move.
+    if (iter == responses.end())
+      throw illegal_move{};
+
+    if (auto best = iter->second->find_best())
+      return sue::node_t::thought_t{iter->second.get(), *best};
+    else
+      return std::nullopt;
   }
 
   void sue::start() {
-    if (brain.init())
-      boost::asio::post(*brain.pool, [this] {
-        root->process(brain);
-      });
+    if (!brain.init())
+      return;
+
+    switch (mode) {
+      case search_mode::Minimax: {
+        brain.post([this] {
+          root->process(brain);
+        });
+      } break;
+      case search_mode::MonteCarlo: {
+        // One stream of playouts per worker
+        for (size_t i = 0; i < brain.pool->size(); ++i) {
+          brain.post([this] {
+            root->run_playouts(brain);
+          });
+        }
+      } break;
+    }
   }
 
-  move_t sue::respond(move_t move) {
+  void sue::set_position(board_t b, bool white_to_move) {
+    stop();
+    root = std::make_unique<node_t>(std::move(b), white_to_move);
+    brain.history.clear();
+    brain.max_move_seen = root->half_moves_made;
+    brain.nodes = 0;
+    start();
+  }
+
+  void sue::play(move_t move) {
     stop();
-    std::optional<sue::node_t::thought_t> res;
-    root->evaluate(brain, true);
-    while (!(res = root->find_best_response(move))) {
-      // Give it another chance
+    root->expand(brain);
+
+    auto iter = root->responses.find(move);
+    if (iter == root->responses.end()) {
+      // Put things back the way they were
       start();
-      std::this_thread::sleep_for(100ms);
-      stop();
+      throw illegal_move{};
     }
 
+    brain.history.push_back(root->hash);
+
     // This is faster
-    auto new_node = res->first->responses.extract(res->second);
-    root = std::move(new_node.mapped());
+    root = std::move(root->responses.extract(iter).mapped());
+    root->parent = nullptr;
+
+    // We only assumed a repetition was a draw to save time, so it's worth a proper look now
+    if (root->drawn_by_rule) {
+      root->state = game_state::NotAWin;
+      root->drawn_by_rule = false;
+      // Monte Carlo never expanded it, so let it have another go
+      root->mcts_expansion = 0;
+    }
 
     start();
-    return new_node.key();
+  }
+
+  sue::search_result_t sue::search(search_limits_t lim) {
+    auto begin = std::chrono::steady_clock::now();
+    auto deadline = begin + lim.time;
+
+    bool limited = lim.depth || lim.nodes;
+    auto limit_reached = [&] {
+      if (brain.hurry)
+        return true;
+      if (std::chrono::steady_clock::now() >= deadline)
+        return true;
+      // The workers won't go past the limits, so once they run out of work we are done
+      if (limited && !brain.lane->busy())
+        return true;
+      // Playouts never run out of work, so for them we stop when we hit the limits instead
+      if (mode == search_mode::MonteCarlo && lim.depth && brain.max_move_seen - root->half_moves_made >= lim.depth)
+        return true;
+      if (lim.nodes && brain.node_budget <= 0)
+        return true;
+      return false;
+    };
+
+    if (auto res = result())
+      throw *res;
+
+    // We are on the clock, so go ahead of anyone who is only pondering
+    brain.lane->set_urgent(true);
+
+    // Tell the workers first, as they may already be pondering
+    brain.expand_before = lim.depth ? root->half_moves_made + lim.depth : 0;
+    brain.node_budget = static_cast<long long>(lim.nodes);
+    brain.node_limited = lim.nodes != 0;
+
+    std::optional<node_t::choice_t> res;
+    start();
+    // Only now, as any pondering that started before the limits went in may still be finishing off a node
+    size_t nodes_at_start = brain.nodes;
+    do {
+      // Keep checking, so that we stop within a millisecond of being told to
+      while (!limit_reached())
+        std::this_thread::sleep_for(1ms);
+      stop();
+      // Make sure there is something to choose from, even if we were stopped straight away
+      if (brain.hurry)
+        root->expand(brain);
+      if (mode == search_mode::MonteCarlo)
+        res = root->most_visited();
+      // Minimax is also the fallback if the playouts haven't got anywhere yet
+      if (!res) {
+        root->evaluate(brain);
+        // Within the limits there may be nothing more to learn
+        res = root->find_best(brain.hurry || limited);
+      }
+      // Someone has searched this position before, so go with what they found
+      if (!res && brain.cache && root->state == game_state::InProgress) {
+        if (auto hit = brain.cache->probe(root->hash); hit) {
+          if (auto iter = root->responses.find(hit->best); iter != root->responses.end())
+            res = iter;
+        }
+      }
+      // If we still don't know enough, give it another chance
+      if (!res) {
+        deadline = std::chrono::steady_clock::now() + 100ms;
+        start();
+      }
+    }
+    while (!res);
+
+    // Pondering goes as far as it likes, but waits its turn
+    brain.expand_before = 0;
+    brain.node_limited = false;
+    brain.lane->set_urgent(false);
+
+    search_result_t ret;
+    ret.best = (*res)->first;
+    if (auto& chosen = *(*res)->second; mode == search_mode::MonteCarlo && chosen.visits)
+      // How often we expect to win, scaled to look like a score
+      ret.stats.score = chosen.value / static_cast<leaf_t>(chosen.visits) - 1;
+    else
+      ret.stats.score = root->weight;
+    ret.stats.depth = brain.max_move_seen - root->half_moves_made;
+    // The budget is exact, whereas the count may have picked up the end of some pondering
+    if (lim.nodes)
+      ret.stats.nodes = lim.nodes - static_cast<size_t>(std::max<long long>(brain.node_budget, 0));
+    else
+      ret.stats.nodes = brain.nodes - nodes_at_start;
+    ret.stats.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin);
+
+    if (thinking_out)
+      *thinking_out << ret.stats.depth << ' ' << ret.stats.score * 100 << ' ' << ret.stats.elapsed.count() / 10
+                    << ' ' << ret.stats.nodes << ' ' << std::string_view{move2str(ret.best).data(), 4} << std::endl;
+
+    return ret;
+  }
+
+  std::optional<game_over> sue::result() {
+    switch (root->state) {
+      case game_state::WhiteWins:
+      case game_state::BlackWins:
+        return game_over{root->state};
+      default: break;
+    }
+
+    if (root->quiet_moves >= node_t::fifty_move_plies)
+      return game_over{game_state::Draw, "Draw by fifty move rule"};
+    // This is the third time we have seen this position
+    if (std::count(brain.history.begin(), brain.history.end(), root->hash) >= 2)
+      return game_over{game_state::Draw, "Draw by repetition"};
+    if (root->state == game_state::Draw)
+      return game_over{game_state::Draw};
+
+    return std::nullopt;
+  }
+
+  std::vector<std::string> sue::options() {
+    // The star marks whichever we are using now
+    return {mode == search_mode::Minimax ? "Search -combo *Minimax /// MCTS" : "Search -combo Minimax /// *MCTS"};
+  }
+
+  void sue::set_option(const std::string& name, const std::string& value) {
+    if (name != "Search")
+      throw std::invalid_argument("Unknown option " + name);
+
+    search_mode new_mode;
+    if (value == "Minimax")
+      new_mode = search_mode::Minimax;
+    else if (value == "MCTS")
+      new_mode = search_mode::MonteCarlo;
+    else
+      throw std::invalid_argument("Unknown search " + value);
+
+    stop();
+    mode = new_mode;
+    start();
+  }
+
+  move_t sue::respond(move_t move) {
+    play(move);
+    auto res = search(limits);
+    // Nobody wants the answer, so don't commit to it
+    if (brain.abandon)
+      throw search_abandoned{};
+    play(res.best);
+    return res.best;
   }
 }
@@ -1,80 +1,260 @@
 #pragma once
 
+#include "cache.hpp"
+#include "hash.hpp"
+#include "pool.hpp"
 #include "xboard.hpp"
 
 //#define TBB_PREVIEW_CONCURRENT_ORDERED_CONTAINERS true
 //#include <tbb/concurrent_map.h>
 
+#include <array>
+#include <chrono>
 #include <condition_variable>
 #include <optional>
 #include <variant>
 #include <map>
 #include <mutex>
-
-#include <boost/asio/thread_pool.hpp>
+#include <vector>
 
 namespace aunty_sue {
   class sue : public XBoardEngine {
-  private:
+    /// Lets the benchmarks get at the internals
+    friend struct sue_bench;
+
+  public:
     using leaf_t = double;
 
+    enum class search_mode {
+      /// Expand everything, and back up the scores
+      Minimax,
+      /// Grow the tree towards the moves that do well in random playouts
+      MonteCarlo
+    };
+
+    struct search_limits_t {
+      /// How long we may think for before giving an answer
+      std::chrono::milliseconds time = std::chrono::milliseconds{100};
+      /// Expand nothing more than this many plies past the root, and stop once everything within that is done.
+      /// 0 means no limit
+      ///
+      /// Lines that were already grown while pondering are kept, so the stats may show more
+      int depth = 0;
+      /// Expand no more than this many nodes, and stop once they are done. 0 means no limit
+      size_t nodes = 0;
+    };
+
+    struct search_stats_t {
+      leaf_t score;
+      /// The deepest ply past the root that we have looked at
+      int depth;
+      size_t nodes;
+      std::chrono::milliseconds elapsed;
+    };
+
+    struct search_result_t {
+      move_t best;
+      search_stats_t stats;
+    };
+
+  private:
     struct brain_t {
       std::atomic<bool> thinking = false;
-      std::unique_ptr<boost::asio::thread_pool> pool = std::make_unique<boost::asio::thread_pool>();
+      /// Set when we have been asked to answer immediately
+      std::atomic<bool> hurry = false;
+      /// Set when the answer is no longer wanted at all
+      std::atomic<bool> abandon = false;
+      std::shared_ptr<shared_pool_t> pool;
+      std::unique_ptr<shared_pool_t::lane_t> lane;
       std::atomic<int> max_move_seen = 0;
+      std::atomic<size_t> nodes = 0;
+      /// Nothing this many half moves into the game or later gets expanded. 0 means no limit
+      std::atomic<int> expand_before = 0;
+      /// How many more nodes we may expand, if node_limited is set
+      std::atomic<long long> node_budget = 0;
+      std::atomic<bool> node_limited = false;
+      /// Results from previous searches, if we have been given somewhere to keep them
+      std::shared_ptr<position_cache_t> cache;
+      /// The positions played in this game before the root, oldest first
+      std::vector<hash_t> history;
 
       inline bool init() {
-        if (!thinking.exchange(true)) {
-          pool = std::make_unique<boost::asio::thread_pool>();
-          return true;
-        }
-        else return false;
+        return !thinking.exchange(true);
+      }
+      template<typename Func>
+      inline void post(Func&& f) {
+        lane->post(std::forward<Func>(f));
       }
       void stop();
-      void wait();
+      /// Checks that expanding a node this far into the game is within the search limits, and counts it if so
+      bool may_expand(int half_moves_made);
+
+      inline brain_t(std::shared_ptr<shared_pool_t> pool_) :
+        pool{std::move(pool_)}, lane{pool->make_lane()} {}
     };
 
     struct node_t {
       std::map<move_t, std::unique_ptr<node_t>> responses;
+      /// Null for the root
+      node_t* parent = nullptr;
       leaf_t weight = std::numeric_limits<leaf_t>::quiet_NaN();
       board_t board;
       bool is_white;
+      hash_t hash;
       game_state state = game_state::Unknown;
       int half_moves_made = 0;
+      /// Plies since the last capture or pawn move, as nothing before one of those can ever repeat
+      int quiet_moves = 0;
+      /// Set if this line was cut short by the fifty move rule or a repetition
+      bool drawn_by_rule = false;
+      /// How many plies every line below here has been searched to, as of the last evaluate
+      int depth = 0;
+      /// Set by evaluate if the score leans on a line drawn by rule, so only holds for the moves that got us here
+      bool history_dependent = false;
+
+      /// Monte Carlo statistics. Each playout through here adds 0 for a loss, 1 for a draw and 2 for a win,
+      /// for whoever moved into this position
+      ///
+      /// visits goes up on the way down, and value on the way back, so a playout in flight counts as a loss (virtual loss)
+      std::atomic<int> visits = 0;
+      std::atomic<int> value = 0;
+      /// 0 until someone claims this for a Monte Carlo expansion, 1 while they do it, 2 once it is safe to walk the responses
+      std::atomic<int> mcts_expansion = 0;
+      /// Set by update_moves if the responses are all (compulsory) captures
+      bool must_take = false;
 
-      using thought_t = std::pair<node_t*, decltype(responses)::iterator>;
+      /// How far we chase capture sequences past a leaf before we give up and count material
+      static constexpr int max_quiescence_plies = 8;
+      static constexpr int fifty_move_plies = 100;
+      /// The depth of a result that no amount of searching could change
+      static constexpr int exact_depth = std::numeric_limits<int>::max();
+      /// Playouts that go on longer than this are decided on material
+      static constexpr int max_playout_plies = 64;
+      static constexpr leaf_t exploration = 1.4142135623730951;
 
+      /// A list of moves that lives on the stack, for when we don't want to grow the tree
+      struct move_list_t {
+        /// No more than 16 pieces a side, none of which can have more than 27 moves
+        std::array<move_t, 16 * 27> moves;
+        size_t size = 0;
+
+        inline void push_back(move_t m) { moves[size++] = m; }
+        inline void clear() { size = 0; }
+        inline bool empty() const { return size == 0; }
+        inline auto begin() const { return moves.begin(); }
+        inline auto end() const { return moves.begin() + size; }
+      };
+
+      using choice_t = decltype(responses)::iterator;
+      using thought_t = std::pair<node_t*, choice_t>;
+
+      /// Picks our best move from this position, or nullopt if we need more time
+      ///
+      /// If we are in a hurry, unexplored moves are judged on their quick eval
+      std::optional<choice_t> find_best(bool hurry = false);
+      /// Picks our best response to the opponent playing the given move from this position
       std::optional<thought_t> find_best_response(move_t);
 
       void update_moves();
+      /// Fills in the legal moves, which are all captures if there are any. Returns whether they are
+      static bool legal_moves(const board_t& board, bool is_white, move_list_t& moves);
+      /// Whether nothing before this move could ever come back, as it takes something or moves a pawn
+      static inline bool is_irreversible(const board_t& board, move_t m) {
+        return board[m.second.first][m.second.second] != EmptySquare || (board[m.first.first][m.first.second] & Pawn);
+      }
+      static inline void make_move(board_t& board, move_t m) {
+        auto& from = board[m.first.first][m.first.second];
+        board[m.second.first][m.second.second] = static_cast<piece_t>(from | HAS_MOVED);
+        from = EmptySquare;
+      }
+      /// How many more pieces the opponent has than the side to move
+      static leaf_t material(const board_t& board, bool is_white);
+      /// Generates the responses, if we haven't already
+      void expand(const brain_t& brain);
+      /// Whether this position has come up before, on this line or earlier in the game
+      bool is_repetition(const brain_t& brain) const;
+      /// Marks the position as a draw if the fifty move rule or a repetition says it is one
+      bool check_draw(const brain_t& brain);
 
       void update_state() {
         state = get_board_state(board);
       }
 
       void quick_eval();
+      /// Plays out the forced captures from a leaf, and scores the quiet positions at the end of them
+      ///
+      /// Returns the score from the point of view of the side to move. Works on copies of the board, so never
+      /// touches the tree. Settles for the material count as soon as we stop thinking
+      static leaf_t quiesce(const brain_t& brain, const board_t& board, bool is_white, leaf_t alpha, leaf_t beta,
+                            int plies_left);
       void process(brain_t& brain);
-      void evaluate(brain_t& brain, bool top = false);
+      void evaluate(brain_t& brain);
+
+      /// Runs one Monte Carlo playout from here, and then queues up another, until we stop
+      void run_playouts(brain_t& brain);
+      /// Walks down the tree to a leaf, plays a random game from there, and records how it went
+      void simulate(brain_t& brain);
+      /// Picks the response most worth a look, by UCT
+      node_t* select();
+      /// Plays random moves until the game is over
+      game_state playout() const;
+      /// The most visited response, if we have visited any
+      std::optional<choice_t> most_visited();
 
       inline void add_move(move_t m) {
-        auto& node = *responses.emplace(m, std::make_unique<node_t>(board, !is_white)).first->second;
-        auto& from = node.board[m.first.first][m.first.second];
-        auto& to = node.board[m.second.first][m.second.second];
-        to = static_cast<piece_t>(from | HAS_MOVED);
-        from = EmptySquare;
+        auto& node = *responses.emplace(m, std::make_unique<node_t>(board, !is_white, hash_move(hash, board, m))).first->second;
+        bool irreversible = is_irreversible(board, m);
+        make_move(node.board, m);
+        // The constructor only saw the board before the move
+        node.update_state();
+        node.parent = this;
         node.half_moves_made = half_moves_made + 1;
+        node.quiet_moves = irreversible ? 0 : quiet_moves + 1;
       }
 
-      inline node_t(decltype(board) board_, bool white_side) :
-        board{std::move(board_)}, is_white{white_side} {
+      inline node_t(decltype(board) board_, bool white_side, hash_t hash_) :
+        board{std::move(board_)}, is_white{white_side}, hash{hash_} {
         update_state();
       }
+      inline node_t(decltype(board) board_, bool white_side) :
+        node_t(board_, white_side, hash_board(board_, white_side)) {}
     };
 
   private:
     brain_t brain;
     std::unique_ptr<node_t> root;
 
+  public:
+    /// Where to post thinking output, if anywhere
+    std::ostream* thinking_out = nullptr;
+    /// The limits used when answering a move through respond
+    search_limits_t limits;
+    /// Only changes when the engine is next started
+    search_mode mode = search_mode::Minimax;
+
+  public:
+    /// Sets up the position, with the given side to move. Starts pondering
+    void set_position(board_t b, bool white_to_move);
+    /// Makes a move from the current position, for either side. Starts pondering
+    ///
+    /// Throws illegal_move if the move is not legal
+    void play(move_t move);
+    /// Thinks about the current position, and returns the best move for the side to move
+    ///
+    /// Does not make the move. Throws game_over if there is no move to make.
+    /// Returns early if move_now has been called since the last clear_move_now
+    search_result_t search(search_limits_t lim);
+
+    /// Shares results with every other engine using the same cache, including future ones
+    inline void use_cache(std::shared_ptr<position_cache_t> cache) {
+      stop();
+      brain.cache = std::move(cache);
+      start();
+    }
+
+    inline const board_t& board() const { return root->board; }
+    inline bool white_to_move() const { return root->is_white; }
+
   public:
     void reset() override {
       stop();
@@ -84,10 +264,29 @@ namespace aunty_sue {
       brain.stop();
     }
     inline void new_game(bool is_white, board_t b) override {
-      stop();
-      root = std::make_unique<node_t>(std::move(b), !is_white);
-      start();
+      // The opponent moves first
+      set_position(std::move(b), !is_white);
     }
     move_t respond(move_t move) override;
+    std::optional<game_over> result() override;
+    std::vector<std::string> options() override;
+    void set_option(const std::string& name, const std::string& value) override;
+    inline void move_now() override {
+      brain.hurry = true;
+    }
+    inline void abandon_move() override {
+      brain.abandon = true;
+      brain.hurry = true;
+    }
+    inline void clear_move_now() override {
+      brain.hurry = false;
+      brain.abandon = false;
+    }
+
+  public:
+    /// Searches on the given pool, which may be shared with other engines
+    inline sue(std::shared_ptr<shared_pool_t> pool = std::make_shared<shared_pool_t>()) :
+      brain{std::move(pool)}, root{std::make_unique<node_t>(default_board, true)} {}
+    inline ~sue() { stop(); }
   };
 }
@@ -2,67 +2,20 @@
 
 #include <signal.h>
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <map>
+#include <mutex>
 #include <sstream>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 namespace aunty_sue {
-  enum class xboard_verb {
-    Xboard,
-    ProtoVer,
-    Accepted,
-    Rejected,
-    New,
-    Variant,
-    Quit,
-    Random,
-    Force,
-    Go,
-    PlayOther,
-    White,
-    Black,
-    Level,
-    St,
-    Sd,
-    Nps,
-    Time,
-    OTim,
-    UserMove,
-    MoveNow,
-    Result,
-    SetBoard,
-    Edit,
-    Hint,
-    Bk,
-    Undo,
-    Remove,
-    Hard,
-    Easy,
-    Post,
-    NoPost,
-    Analyze,
-    Name,
-    Rating,
-    Ics,
-    Computer,
-    Pause,
-    Resume,
-    Memory,
-    Corse,
-    EgtPath,
-    Option,
-    Exclude,
-    Include,
-    SetScore,
-    Lift,
-    Put,
-    Hover
-  };
-
   std::pair<xboard_verb, std::vector<std::string>> parse_line(std::string line) {
     std::pair<xboard_verb, std::vector<std::string>> ret;
 
@@ -90,6 +43,8 @@ namespace aunty_sue {
       {"usermove", xboard_verb::UserMove},
       {"hint", xboard_verb::Hint},
       {"variant", xboard_verb::Variant},
+      {"?", xboard_verb::MoveNow},
+      {"option", xboard_verb::Option},
     };
 
     if (auto iter = verb_tab.find(verb); iter != verb_tab.end())
@@ -103,15 +58,143 @@ namespace aunty_sue {
     return ret;
   }
 
-  void run_engine(XBoardEngine& eng, std::istream& in, std::ostream& out) {
-    signal(SIGINT, SIG_IGN);
+  namespace {
+    using command_t = std::pair<xboard_verb, std::vector<std::string>>;
+
+    /// Whether any move the engine is thinking about should be thrown away when it sees this
+    bool is_abandon(xboard_verb verb) {
+      switch (verb) {
+        case xboard_verb::Force:
+        case xboard_verb::New:
+        case xboard_verb::Quit:
+          return true;
+        default:
+          return false;
+      }
+    }
+
+    /// Whether the engine should drop what it is doing when it sees this, rather than finish thinking first
+    bool is_interrupt(xboard_verb verb) {
+      return verb == xboard_verb::MoveNow || is_abandon(verb);
+    }
 
-    std::string line;
+    void report_result(std::ostream& out, const game_over& res) {
+      switch (res.final_state) {
+        case game_state::WhiteWins: out << "1-0"; break;
+        case game_state::BlackWins: out << "0-1"; break;
+        default: out << "1/2-1/2"; break;
+      }
+      out << " {" << res.what() << '}' << std::endl;
+    }
+
+    struct command_queue_t {
+      std::mutex mutex;
+      std::condition_variable cv;
+      std::deque<command_t> commands;
+      /// Set if the reader gave up on a bad line
+      std::exception_ptr error;
+      bool done = false;
+      /// Set once nobody is listening, after which the reader must not touch the engine
+      bool closed = false;
+    };
+  }
+
+  void run_engine(XBoardEngine& eng, std::istream& in, std::ostream& out, std::function<void()> close_input) {
+    signal(SIGINT, SIG_IGN);
 
     std::filesystem::remove("/tmp/aunty_sue.log");
 
-    while (std::getline(in, line)) {
-      auto toks = parse_line(line);
+    // Shared, as the reader may outlive us
+    auto queue_ptr = std::make_shared<command_queue_t>();
+    auto& queue = *queue_ptr;
+
+    // Keep reading while the engine thinks, so that we can interrupt it
+    std::thread reader{[&in, &eng, queue_ptr] {
+      auto& queue = *queue_ptr;
+      std::string line;
+      try {
+        while (std::getline(in, line)) {
+          auto toks = parse_line(line);
+          auto verb = toks.first;
+
+          {
+            // Under the lock, so the main loop can't clear this before it sees the command
+            std::lock_guard lock{queue.mutex};
+            if (queue.closed)
+              break;
+            if (is_abandon(verb))
+              eng.abandon_move();
+            else if (is_interrupt(verb))
+              eng.move_now();
+            queue.commands.push_back(std::move(toks));
+          }
+          queue.cv.notify_one();
+
+          // Nothing more will be read, so don't block on the stream
+          if (verb == xboard_verb::Quit)
+            break;
+        }
+      }
+      catch (...) {
+        std::lock_guard lock{queue.mutex};
+        queue.error = std::current_exception();
+      }
+
+      {
+        std::lock_guard lock{queue.mutex};
+        queue.done = true;
+      }
+      queue.cv.notify_one();
+    }};
+
+    // The reader uses the stream and the engine, so it must finish before we do, or at least leave them alone
+    struct reader_guard_t {
+      XBoardEngine& eng;
+      std::thread& reader;
+      std::function<void()>& close_input;
+      command_queue_t& queue;
+      ~reader_guard_t() {
+        // No point thinking while we wait
+        eng.stop();
+        {
+          std::lock_guard lock{queue.mutex};
+          queue.closed = true;
+        }
+        // If we are leaving early, the reader may be waiting for a line that never comes
+        if (close_input) {
+          close_input();
+          reader.join();
+        }
+        // We can't wake it up, but it won't touch anything of ours when it does wake up
+        else
+          reader.detach();
+      }
+    } reader_guard{eng, reader, close_input, queue};
+
+    while (true) {
+      command_t toks;
+      {
+        std::unique_lock lock{queue.mutex};
+        queue.cv.wait(lock, [&] { return !queue.commands.empty() || queue.done; });
+        if (queue.commands.empty()) {
+          if (queue.error)
+            std::rethrow_exception(queue.error);
+          return;
+        }
+        toks = std::move(queue.commands.front());
+        queue.commands.pop_front();
+
+        // This interrupt has now been seen to, but any still queued up should stay in force
+        if (is_interrupt(toks.first)) {
+          eng.clear_move_now();
+          for (auto& i : queue.commands) {
+            if (is_abandon(i.first))
+              eng.abandon_move();
+            else if (is_interrupt(i.first))
+              eng.move_now();
+          }
+        }
+      }
 
       switch (toks.first) {
         case xboard_verb::Xboard: {
@@ -135,12 +218,37 @@ namespace aunty_sue {
           out << "feature usermove=1" << std::endl;
           out << "feature time=0" << std::endl;
           out << "feature variants=\"auntysue\"" << std::endl;
+          for (auto& i : eng.options())
+            out << "feature option=\"" << i << '"' << std::endl;
           out << "feature done=1" << std::endl;
         } break;
         case xboard_verb::UserMove: {
-          auto resp = move2str(eng.respond(str2move(toks.second.at(0))));
-          out << "move " << std::string_view{resp.data(), resp.size()} << std::endl;
+          try {
+            auto resp = move2str(eng.respond(str2move(toks.second.at(0))));
+            out << "move " << std::string_view{resp.data(), resp.size()} << std::endl;
+            // Our own move may have finished it
+            if (auto res = eng.result())
+              report_result(out, *res);
+          }
+          catch (game_over& res) {
+            report_result(out, res);
+          }
+          // Whatever came in meanwhile doesn't want our move, so it has gone unplayed
+          catch (search_abandoned&) {}
+          // Nothing has changed, so the game can carry on
+          catch (illegal_move&) {
+            out << "Illegal move: " << toks.second.at(0) << std::endl;
+          }
+        } break;
+        case xboard_verb::Option: {
+          auto& setting = toks.second.at(0);
+          auto split = setting.find('=');
+          if (split == std::string::npos)
+            throw std::invalid_argument("Bad option");
+          eng.set_option(setting.substr(0, split), setting.substr(split + 1));
         } break;
+        // The reader already told the engine to hurry up
+        case xboard_verb::MoveNow: break;
         case xboard_verb::Quit: return;
         default: {}
       }
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <array>
+#include <functional>
 #include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace aunty_sue {
   using coords_t = std::pair<int8_t, int8_t>;
@@ -94,7 +98,7 @@ namespace aunty_sue {
     Unknown
   };
 
-  inline game_state get_board_state(board_t& board) {
+  inline game_state get_board_state(const board_t& board) {
     int white_remains = false, black_remains = false;
 
     // Check if we ran out of pieces
@@ -120,9 +124,17 @@ namespace aunty_sue {
   struct illegal_move : public std::exception {
     const char* what() const noexcept override { return "The opponent made an illegal move"; }
   };
+  /// Thrown by respond when whoever asked for the move no longer wants it
+  struct search_abandoned : public std::exception {
+    const char* what() const noexcept override { return "The search was abandoned"; }
+  };
   struct game_over : public std::exception {
     game_state final_state;
+    /// Why the game ended, if it wasn't obvious from the board
+    const char* reason;
     const char* what() const noexcept override {
+      if (reason)
+        return reason;
       switch(final_state) {
         case game_state::BlackWins: return "Black won the game";
         case game_state::WhiteWins: return "White won the game";
@@ -131,7 +143,7 @@ namespace aunty_sue {
       }
     }
 
-    inline game_over(game_state state) : final_state{state} {}
+    inline game_over(game_state state, const char* reason_ = nullptr) : final_state{state}, reason{reason_} {}
   };
 
   struct XBoardEngine {
@@ -146,9 +158,89 @@ namespace aunty_sue {
     ///
     /// Must throw we_lost if the engine has lost
     virtual move_t respond(move_t) = 0;
+    /// Whether the game has finished, and how. Should not be called during respond
+    virtual std::optional<game_over> result() = 0;
+    /// Makes a running respond return as soon as it can, with the best move found so far
+    ///
+    /// Called from a different thread to respond, and lasts until clear_move_now
+    virtual void move_now() = 0;
+    /// Like move_now, but respond throws search_abandoned instead of making its move
+    virtual void abandon_move() = 0;
+    /// Called once whatever asked for move_now or abandon_move has been dealt with
+    virtual void clear_move_now() = 0;
+
+    /// The options the engine takes, in the syntax of xboard's feature option (e.g. "Name -check 0")
+    virtual std::vector<std::string> options() { return {}; }
+    /// Must throw std::invalid_argument if the option or value is not understood
+    virtual void set_option(const std::string& name, const std::string& /*value*/) {
+      throw std::invalid_argument("Unknown option " + name);
+    }
 
     virtual ~XBoardEngine() = default;
   };
 
-  void run_engine(XBoardEngine& eng, std::istream& in = std::cin, std::ostream& out = std::cout);
+  enum class xboard_verb {
+    Xboard,
+    ProtoVer,
+    Accepted,
+    Rejected,
+    New,
+    Variant,
+    Quit,
+    Random,
+    Force,
+    Go,
+    PlayOther,
+    White,
+    Black,
+    Level,
+    St,
+    Sd,
+    Nps,
+    Time,
+    OTim,
+    UserMove,
+    MoveNow,
+    Result,
+    SetBoard,
+    Edit,
+    Hint,
+    Bk,
+    Undo,
+    Remove,
+    Hard,
+    Easy,
+    Post,
+    NoPost,
+    Analyze,
+    Name,
+    Rating,
+    Ics,
+    Computer,
+    Pause,
+    Resume,
+    Memory,
+    Corse,
+    EgtPath,
+    Option,
+    Exclude,
+    Include,
+    SetScore,
+    Lift,
+    Put,
+    Hover
+  };
+
+  /// Splits a line from xboard into its verb and arguments
+  ///
+  /// Throws std::invalid_argument if the verb is not one we know
+  std::pair<xboard_verb, std::vector<std::string>> parse_line(std::string line);
+
+  /// Plays xboard over the given streams until told to quit
+  ///
+  /// in is read from another thread, so must not share any state with out. If close_input is given,
+  /// it is called on the way out to wake up a reader that is still waiting on in. Otherwise the reader is
+  /// left waiting, so in must outlive the call, as std::cin does
+  void run_engine(XBoardEngine& eng, std::istream& in = std::cin, std::ostream& out = std::cout,
+                  std::function<void()> close_input = {});
 }
@@ -0,0 +1,31 @@
+#include "cache.hpp"
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+// A shallow result must not push out a deeper one for the same position
+int main() {
+  using namespace aunty_sue;
+
+  auto path = std::filesystem::temp_directory_path() / ("aunty_sue_cache_depth_" + std::to_string(::getpid()));
+  int ret = 0;
+  {
+    position_cache_t cache{path.string(), 64};
+    hash_t key = 0x123456789abcdef;
+    move_t move = str2move("e2e4");
+
+    cache.store(key, {1.0f, 9, move});
+    cache.store(key, {2.0f, 3, move});
+
+    auto hit = cache.probe(key);
+    if (!hit || hit->depth != 9) {
+      std::cerr << "Expected depth 9, got " << (hit ? hit->depth : -1) << std::endl;
+      ret = 1;
+    }
+  }
+  std::filesystem::remove(path);
+  return ret;
+}
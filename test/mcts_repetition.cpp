@@ -0,0 +1,32 @@
+#include "sue.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string_view>
+#include <thread>
+
+// Shuffling the rooks back to where they started makes the root a repetition,
+// which Monte Carlo may already have claimed while pondering. The search must still come back
+int main() {
+  using namespace aunty_sue;
+
+  board_t board;
+  for (auto& rank : board)
+    rank.fill(EmptySquare);
+  board[0][0] = white(Rook);
+  board[7][7] = black(Rook);
+
+  sue eng{std::make_shared<shared_pool_t>(2)};
+  eng.mode = sue::search_mode::MonteCarlo;
+  eng.set_position(board, true);
+
+  for (auto* i : {"a1a2", "h8h7", "a2a1", "h7h8"}) {
+    // Give the ponderer time to claim the nodes we are about to visit
+    std::this_thread::sleep_for(std::chrono::milliseconds{20});
+    eng.play(str2move(i));
+  }
+
+  auto res = eng.search({std::chrono::milliseconds{50}});
+  auto str = move2str(res.best);
+  std::cout << std::string_view{str.data(), str.size()} << std::endl;
+}